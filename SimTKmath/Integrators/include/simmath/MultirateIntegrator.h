@@ -0,0 +1,158 @@
+#ifndef SimTK_SIMMATH_MULTIRATE_INTEGRATOR_H_
+#define SimTK_SIMMATH_MULTIRATE_INTEGRATOR_H_
+
+/* -------------------------------------------------------------------------- *
+ *                        Simbody(tm): SimTKmath                              *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2014 Stanford University and the Authors.           *
+ * Authors:                                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+#include "SimTKcommon.h"
+#include "simmath/internal/common.h"
+#include "simmath/Integrator.h"
+
+namespace SimTK {
+
+class MultirateIntegratorRep;
+
+/** This is an error-controlled, second-order explicit Integrator that
+advances a selected subset of the auxiliary continuous state variables z (the
+"fast" variables) with several substeps for each step taken by the rest of the
+state (the "slow" variables q, u, and the remaining z's).
+
+Every continuous state variable normally advances with a single step size, and
+that step size is chosen by the stiffest component in the System. When that
+component is a cheap auxiliary variable, for example the chain variables of a
+Nose-Hoover thermostat or a stiff first-order filter or activation state, the
+expensive multibody dynamics ends up being evaluated far more often than the
+motion requires. This integrator separates the two time scales.
+
+<h3>Theory</h3>
+
+This is a "slowest-first" multirate scheme built on the explicit trapezoid
+rule (see RungeKutta2Integrator). Given a step of size H from t0 to t1=t0+H
+with n substeps of size h=H/n, we:
+  -# Predict the slow variables at t1 with an Euler step ys* = ys0 + H ys0'.
+  -# Integrate the fast variables zf from t0 to t1 with n explicit trapezoid
+     substeps, with the slow variables linearly interpolated between ys0 and
+     ys*. The fast derivatives are evaluated by realizing the System only
+     through the "fast rate stage" (Stage::Dynamics by default), so the
+     Acceleration stage (where the matter subsystem performs its articulated
+     body computations) is never realized during the substeps.
+  -# Evaluate the full derivatives f1 at (t1, ys*, zf1), then correct the slow
+     variables with ys1 = ys0 + (H/2)(ys0' + ys1').
+
+The slow error estimate is the embedded first-order one used by
+RungeKutta2Integrator. The fast error estimate is the sum of the per-substep
+embedded estimates, plus a term for the error introduced by moving the slow
+variables along their Euler prediction rather than the corrected path: we
+re-evaluate the fast derivatives at (t1, ys1, zf1) and charge (H/2) times
+their change from those seen at (t1, ys*, zf1). That evaluation also serves as
+the end-of-step kinematics realization.
+
+A step therefore costs 2n realizations through the fast rate stage, while the
+number of Acceleration-stage realizations is the same as for
+RungeKutta2Integrator (one for f1 and one for the end-of-step derivatives) and
+does not depend on n.
+
+<h3>Choosing the fast variables</h3>
+
+Fast variables are specified per Subsystem, either as all the z's allocated by
+that Subsystem or as a contiguous range of its z's. The specifications are
+resolved when the integrator is initialized, so they may be given before the
+System's Model stage has been realized.
+
+Force elements that own state variables (such as a Force::Thermostat) allocate
+them in their GeneralForceSubsystem, and the Force API does not report where
+they are. So the practical way to make a Force's z's fast is to give the fast
+Forces a GeneralForceSubsystem of their own and call addFastSubsystem() on it.
+Calling addFastSubsystem() on a GeneralForceSubsystem that is shared with
+other Forces also substeps their z's, such as the dissipated energy
+accumulators of Force::LinearBushing and CableSpring.
+
+The derivatives of the fast z's must be available after realizing the fast
+rate stage. Force::Thermostat computes its chain variable derivatives at
+Dynamics stage, so it works with the default. Many other z's, including the
+dissipated energy accumulators mentioned above, the CablePath length integral,
+and Measure::Integrate, are computed in realizeAcceleration(); with the
+default fast rate stage their substeps would see stale derivatives. For those,
+set the fast rate stage to Stage::Acceleration; substepping still improves
+stability for stiff z's but no evaluation cost is saved.
+
+Only auxiliary variables z may be assigned to the fast rate. Force
+contributions to the generalized accelerations cannot be separated from the
+rest of the dynamics at this level, since that would require the matter
+subsystem to compute a partial udot.
+**/
+class SimTK_SIMMATH_EXPORT MultirateIntegrator : public Integrator {
+public:
+    /** Create a MultirateIntegrator for integrating a System with variable
+    size steps. No variables are fast until you assign some. **/
+    explicit MultirateIntegrator(const System& sys);
+
+    /** Create a MultirateIntegrator for integrating a System with variable
+    size steps, taking \a numSubsteps substeps for the fast variables during
+    each step. **/
+    MultirateIntegrator(const System& sys, int numSubsteps);
+
+    /** Assign \a numZ of the z's belonging to Subsystem \a subsys, starting
+    at the Subsystem-local index \a firstZ, to the fast rate. This takes
+    effect the next time the integrator is initialized. **/
+    void addFastZ(SubsystemIndex subsys, ZIndex firstZ, int numZ=1);
+
+    /** Assign all the z's belonging to Subsystem \a subsys to the fast rate.
+    This takes effect the next time the integrator is initialized. **/
+    void addFastSubsystem(SubsystemIndex subsys);
+
+    /** Remove all fast variable assignments. **/
+    void clearFastZ();
+
+    /** Set the number of substeps the fast variables take during each step
+    of the slow variables. Must be at least 1; the default is 10. **/
+    void setNumSubsteps(int numSubsteps);
+    /** Get the number of substeps taken by the fast variables for each step
+    of the slow variables. **/
+    int getNumSubsteps() const;
+
+    /** Set the Stage through which the System is realized to evaluate the
+    derivatives of the fast variables. Must be between Stage::Dynamics (the
+    default) and Stage::Acceleration. **/
+    void setFastRateStage(Stage stage);
+    /** Get the Stage through which the System is realized to evaluate the
+    derivatives of the fast variables. **/
+    Stage getFastRateStage() const;
+
+    /** Return the number of z's assigned to the fast rate. This is only
+    available after the integrator has been initialized. **/
+    int getNumFastZ() const;
+
+    /** Return the total number of fast substeps taken since the last call to
+    resetAllStatistics(). **/
+    int getNumSubstepsTaken() const;
+
+    /** Return the number of times the System was realized only through the
+    fast rate stage to evaluate the fast derivatives. These evaluations are
+    not included in getNumRealizations(). **/
+    int getNumFastRealizations() const;
+};
+
+} // namespace SimTK
+
+#endif // SimTK_SIMMATH_MULTIRATE_INTEGRATOR_H_
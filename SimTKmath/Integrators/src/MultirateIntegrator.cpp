@@ -0,0 +1,342 @@
+/* -------------------------------------------------------------------------- *
+ *                        Simbody(tm): SimTKmath                              *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2014 Stanford University and the Authors.           *
+ * Authors:                                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/** @file
+ * This is the private (library side) implementation of the 
+ * MultirateIntegrator and MultirateIntegratorRep classes.
+ */
+
+#include "SimTKcommon.h"
+#include "simmath/Integrator.h"
+#include "simmath/MultirateIntegrator.h"
+
+#include "IntegratorRep.h"
+#include "MultirateIntegratorRep.h"
+
+using namespace SimTK;
+
+//------------------------------------------------------------------------------
+//                          MULTIRATE INTEGRATOR
+//------------------------------------------------------------------------------
+
+MultirateIntegrator::MultirateIntegrator(const System& sys) {
+    rep = new MultirateIntegratorRep(this, sys);
+}
+
+MultirateIntegrator::MultirateIntegrator(const System& sys, int numSubsteps) {
+    rep = new MultirateIntegratorRep(this, sys);
+    setNumSubsteps(numSubsteps);
+}
+
+void MultirateIntegrator::addFastZ
+   (SubsystemIndex subsys, ZIndex firstZ, int numZ) {
+    MultirateIntegratorRep& mrep = dynamic_cast<MultirateIntegratorRep&>(*rep);
+    mrep.addFastZ(subsys, firstZ, numZ);
+}
+
+void MultirateIntegrator::addFastSubsystem(SubsystemIndex subsys) {
+    MultirateIntegratorRep& mrep = dynamic_cast<MultirateIntegratorRep&>(*rep);
+    mrep.addFastSubsystem(subsys);
+}
+
+void MultirateIntegrator::clearFastZ() {
+    MultirateIntegratorRep& mrep = dynamic_cast<MultirateIntegratorRep&>(*rep);
+    mrep.clearFastZ();
+}
+
+void MultirateIntegrator::setNumSubsteps(int numSubsteps) {
+    MultirateIntegratorRep& mrep = dynamic_cast<MultirateIntegratorRep&>(*rep);
+    mrep.setNumSubsteps(numSubsteps);
+}
+
+int MultirateIntegrator::getNumSubsteps() const {
+    const MultirateIntegratorRep& mrep = 
+        dynamic_cast<const MultirateIntegratorRep&>(*rep);
+    return mrep.getNumSubsteps();
+}
+
+void MultirateIntegrator::setFastRateStage(Stage stage) {
+    MultirateIntegratorRep& mrep = dynamic_cast<MultirateIntegratorRep&>(*rep);
+    mrep.setFastRateStage(stage);
+}
+
+Stage MultirateIntegrator::getFastRateStage() const {
+    const MultirateIntegratorRep& mrep = 
+        dynamic_cast<const MultirateIntegratorRep&>(*rep);
+    return mrep.getFastRateStage();
+}
+
+int MultirateIntegrator::getNumFastZ() const {
+    const MultirateIntegratorRep& mrep = 
+        dynamic_cast<const MultirateIntegratorRep&>(*rep);
+    return mrep.getNumFastZ();
+}
+
+int MultirateIntegrator::getNumSubstepsTaken() const {
+    const MultirateIntegratorRep& mrep = 
+        dynamic_cast<const MultirateIntegratorRep&>(*rep);
+    return mrep.getNumSubstepsTaken();
+}
+
+int MultirateIntegrator::getNumFastRealizations() const {
+    const MultirateIntegratorRep& mrep = 
+        dynamic_cast<const MultirateIntegratorRep&>(*rep);
+    return mrep.getNumFastRealizations();
+}
+
+
+
+//------------------------------------------------------------------------------
+//                        MULTIRATE INTEGRATOR REP
+//------------------------------------------------------------------------------
+
+MultirateIntegratorRep::MultirateIntegratorRep
+   (Integrator* handle, const System& sys) 
+:   AbstractIntegratorRep(handle, sys, 2, 2, "Multirate",  true),
+    numSubsteps(10), fastRateStage(Stage::Dynamics),
+    statsSubstepsTaken(0), statsFastRealizations(0) {
+}
+
+void MultirateIntegratorRep::addFastZ
+   (SubsystemIndex subsys, ZIndex firstZ, int numZ) {
+    SimTK_APIARGCHECK1_ALWAYS(subsys.isValid(), "MultirateIntegrator", 
+        "addFastZ", "Subsystem index %d is not valid.", (int)subsys);
+    SimTK_APIARGCHECK2_ALWAYS(firstZ.isValid() && numZ >= 0, 
+        "MultirateIntegrator", "addFastZ", 
+        "Bad range of z's: first=%d, count=%d.", (int)firstZ, numZ);
+    fastZSpecs.push_back(FastZSpec(subsys, firstZ, numZ));
+}
+
+void MultirateIntegratorRep::addFastSubsystem(SubsystemIndex subsys) {
+    SimTK_APIARGCHECK1_ALWAYS(subsys.isValid(), "MultirateIntegrator", 
+        "addFastSubsystem", "Subsystem index %d is not valid.", (int)subsys);
+    fastZSpecs.push_back(FastZSpec(subsys, ZIndex(0), -1));
+}
+
+void MultirateIntegratorRep::clearFastZ() {
+    fastZSpecs.clear();
+}
+
+void MultirateIntegratorRep::setNumSubsteps(int n) {
+    SimTK_APIARGCHECK1_ALWAYS(n >= 1, "MultirateIntegrator", "setNumSubsteps",
+        "The number of substeps must be at least 1 but was %d.", n);
+    numSubsteps = n;
+}
+
+void MultirateIntegratorRep::setFastRateStage(Stage stage) {
+    SimTK_APIARGCHECK1_ALWAYS
+       (Stage::Dynamics <= stage && stage <= Stage::Acceleration,
+        "MultirateIntegrator", "setFastRateStage",
+        "The fast rate stage must be Dynamics or Acceleration but was %s.",
+        stage.getName().c_str());
+    fastRateStage = stage;
+}
+
+int MultirateIntegratorRep::getNumFastZ() const {
+    return (int)fastY.size();
+}
+
+void MultirateIntegratorRep::resetMethodStatistics() {
+    AbstractIntegratorRep::resetMethodStatistics();
+    statsSubstepsTaken = 0;
+    statsFastRealizations = 0;
+}
+
+// Resolve the user's fast variable specifications into indices into the 
+// continuous state vector y=[q u z]. The State is realized through Model stage
+// at least, so the z layout is known.
+void MultirateIntegratorRep::methodInitialize(const State& state) {
+    AbstractIntegratorRep::methodInitialize(state);
+
+    const int nq = state.getNQ(), nu = state.getNU(), ny = state.getNY();
+    isFastY.clear(); isFastY.resize(ny, false);
+    for (unsigned i=0; i < fastZSpecs.size(); ++i) {
+        const FastZSpec& spec = fastZSpecs[i];
+        SimTK_ERRCHK2_ALWAYS(spec.subsys < state.getNumSubsystems(),
+            "MultirateIntegrator::initialize()",
+            "Fast z's were requested for Subsystem %d but there are only %d"
+            " Subsystems.", (int)spec.subsys, state.getNumSubsystems());
+        const int nzSub = state.getNZ(spec.subsys);
+        const int first = spec.numZ < 0 ? 0     : (int)spec.firstZ;
+        const int n     = spec.numZ < 0 ? nzSub : spec.numZ;
+        SimTK_ERRCHK4_ALWAYS(first + n <= nzSub,
+            "MultirateIntegrator::initialize()",
+            "Fast z's %d..%d were requested for Subsystem %d which has only"
+            " %d z's.", first, first+n-1, (int)spec.subsys, nzSub);
+        const int y0 = nq + nu + state.getZStart(spec.subsys) + first;
+        for (int k=0; k < n; ++k)
+            isFastY[y0+k] = true;
+    }
+
+    fastY.clear();
+    for (int i=0; i < ny; ++i)
+        if (isFastY[i]) fastY.push_back(i);
+}
+
+// Set the advanced state to (t,y) and realize it only as far as is needed
+// to evaluate the fast z derivatives. When the fast rate stage is Dynamics, 
+// this skips the Acceleration stage which is where the expensive multibody
+// computations are done. These evaluations don't count as realizations in the
+// generic integrator statistics; we count them separately.
+void MultirateIntegratorRep::calcFastZDot
+   (Real t, const Vector& y, Vector& fastZDot)
+{
+    const System& system = getSystem();
+    State& advanced = updAdvancedState();
+
+    setAdvancedState(t,y);
+
+    // Count this as a failure until it succeeds, as realizeStateDerivatives()
+    // does, so that a throwing realization shows up in the statistics.
+    ++statsFastRealizations; ++statsRealizationFailures;
+    system.realize(advanced, Stage::Time);
+    system.prescribeQ(advanced); // set q_p
+    system.realize(advanced, Stage::Position);
+    system.prescribeU(advanced); // set u_p
+    system.realize(advanced, fastRateStage);
+    --statsRealizationFailures;
+
+    const Vector& zdot   = advanced.getZDot();
+    const int     zStart = advanced.getNQ() + advanced.getNU();
+    for (int i=0; i < (int)fastY.size(); ++i)
+        fastZDot[i] = zdot[fastY[i] - zStart];
+}
+
+// Form the substep evaluation point y at time fraction s of the way through
+// the step, with the slow variables interpolated linearly between y0 and
+// their end-of-step prediction yPred, and the fast variables set to zf.
+void MultirateIntegratorRep::interpolateSlow
+   (Real s, const Vector& y0, const Vector& yPred, const Vector& zf, 
+    Vector& y) const
+{
+    for (int i=0; i < y0.size(); ++i)
+        y[i] = y0[i] + s*(yPred[i]-y0[i]);
+    for (int i=0; i < (int)fastY.size(); ++i)
+        y[fastY[i]] = zf[i];
+}
+
+// This is a slowest-first multirate explicit trapezoid method. See the
+// MultirateIntegrator class documentation for the theory. We call the initial
+// state (t0,y0) and want (t1,y1) with H=t1-t0. We are given the initial 
+// derivative f0=f(t0,y0), which most likely is left over from an evaluation
+// at the end of the last step.
+bool MultirateIntegratorRep::attemptODEStep
+   (Real t1, Vector& y1err, int& errOrder, int& numIterations)
+{
+    const Real t0 = getPreviousTime();
+    assert(t1 > t0);
+
+    statsStepsAttempted++;
+    errOrder = 2;
+    const Vector& y0 = getPreviousY();
+    const Vector& f0 = getPreviousYDot();
+    if (ytmp[0].size() != y0.size())
+        for (int i=0; i<NTemps; ++i)
+            ytmp[i].resize(y0.size());
+    const int nFast = (int)fastY.size();
+    if (ztmp[0].size() != nFast)
+        for (int i=0; i<NZTemps; ++i)
+            ztmp[i].resize(nFast);
+    Vector& yPred = ytmp[0]; // rename temps
+    Vector& ySub  = ytmp[1];
+    Vector& f1    = ytmp[2];
+    Vector& zf    = ztmp[0];
+    Vector& zfErr = ztmp[1];
+    Vector& k1    = ztmp[2];
+    Vector& k2    = ztmp[3];
+
+    const Real H = t1-t0;
+
+    // Predict the slow variables at t1 with an Euler step. The fast 
+    // entries here are meaningless and get replaced below.
+    yPred = y0 + H*f0;
+
+    // Substep the fast variables from t0 to t1 with the slow ones following
+    // their predicted straight-line path. The first substep reuses f0.
+    const Real h = H/numSubsteps;
+    for (int i=0; i < nFast; ++i) {
+        zf[i] = y0[fastY[i]];
+        k1[i] = f0[fastY[i]];
+    }
+    zfErr = 0;
+    for (int k=0; nFast && k < numSubsteps; ++k) {
+        const Real sk  = Real(k)/numSubsteps;
+        const Real sk1 = Real(k+1)/numSubsteps;
+        if (k > 0) {
+            interpolateSlow(sk, y0, yPred, zf, ySub);
+            calcFastZDot(t0 + sk*H, ySub, k1);
+        }
+        // Euler predictor for this substep, then trapezoid corrector.
+        for (int i=0; i < nFast; ++i)
+            k2[i] = zf[i] + h*k1[i];
+        interpolateSlow(sk1, y0, yPred, k2, ySub);
+        calcFastZDot(k+1==numSubsteps ? t1 : t0 + sk1*H, ySub, k2);
+        for (int i=0; i < nFast; ++i) {
+            zf[i] += (h/2)*(k1[i] + k2[i]);
+            // The difference between the Euler and trapezoid results is an
+            // estimate of the local error of the 1st order method.
+            zfErr[i] += (h/2)*std::abs(k2[i] - k1[i]);
+        }
+        ++statsSubstepsTaken;
+    }
+
+    // Full evaluation of the derivatives at the end of the step, using the
+    // slow prediction and the substepped fast values.
+    for (int i=0; i < nFast; ++i)
+        yPred[fastY[i]] = zf[i];
+    setAdvancedStateAndRealizeDerivatives(t1, yPred);
+    f1 = getAdvancedState().getYDot();
+
+    // Final value. Slow variables get the 2nd order trapezoid corrector 
+    // y1 = y0 + (H/2)*(f0 + f1); fast ones keep their substepped values.
+    // Evaluate through kinematics only if there are no fast variables; it is
+    // a waste of a stage to evaluate derivatives here since the caller will
+    // muck with this before the end of the step.
+    ySub = y0 + (H/2)*(f0 + f1);
+    for (int i=0; i < nFast; ++i)
+        ySub[fastY[i]] = zf[i];
+    if (nFast) {
+        // The fast variables were integrated along the Euler-predicted slow
+        // path rather than the corrected one. Realizing the final state 
+        // through the fast rate stage (which includes the kinematics we need
+        // anyway) tells us how much the fast derivatives change between the
+        // two paths at t1; the path difference grows from zero at t0, so 
+        // we use (H/2) times that change as a heuristic estimate of the
+        // coupling error.
+        calcFastZDot(t1, ySub, k1);
+        for (int i=0; i < nFast; ++i)
+            zfErr[i] += (H/2)*std::abs(k1[i] - f1[fastY[i]]);
+    } else
+        setAdvancedStateAndRealizeKinematics(t1, ySub);
+    // YErr is valid now
+
+    // The slow error estimate is the difference from the embedded 1st-order
+    // estimate y1hat = y0 + H*f1; the fast one was accumulated above.
+    const Vector& y1 = getAdvancedState().getY();
+    for (int i=0; i<y1.size(); ++i)
+        y1err[i] = isFastY[i] ? Real(0) : std::abs(y1[i]-(y0[i] + H*f1[i]));
+    for (int i=0; i < nFast; ++i)
+        y1err[fastY[i]] = zfErr[i];
+
+    return true;
+}
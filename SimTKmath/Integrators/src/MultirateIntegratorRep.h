@@ -0,0 +1,94 @@
+#ifndef SimTK_SIMMATH_MULTIRATE_INTEGRATOR_REP_H_
+#define SimTK_SIMMATH_MULTIRATE_INTEGRATOR_REP_H_
+
+/* -------------------------------------------------------------------------- *
+ *                        Simbody(tm): SimTKmath                              *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2014 Stanford University and the Authors.           *
+ * Authors:                                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+#include "AbstractIntegratorRep.h"
+
+namespace SimTK {
+
+/**
+ * This is the private (library side) implementation of the 
+ * MultirateIntegratorRep class which is a concrete class
+ * implementing the abstract IntegratorRep.
+ */
+
+class MultirateIntegratorRep : public AbstractIntegratorRep {
+public:
+    MultirateIntegratorRep(Integrator* handle, const System& sys);
+
+    void addFastZ(SubsystemIndex subsys, ZIndex firstZ, int numZ);
+    void addFastSubsystem(SubsystemIndex subsys);
+    void clearFastZ();
+
+    void setNumSubsteps(int numSubsteps);
+    int getNumSubsteps() const {return numSubsteps;}
+    void setFastRateStage(Stage stage);
+    Stage getFastRateStage() const {return fastRateStage;}
+
+    int getNumFastZ() const;
+    int getNumSubstepsTaken() const {return statsSubstepsTaken;}
+    int getNumFastRealizations() const {return statsFastRealizations;}
+
+    void methodInitialize(const State&);
+    void resetMethodStatistics();
+protected:
+    bool attemptODEStep
+       (Real t1, Vector& yErrEst, int& errOrder, int& numIterations);
+private:
+    // Set the advanced state to (t,y) and realize it only through the fast
+    // rate stage, then extract the fast z derivatives into fastZDot.
+    void calcFastZDot(Real t, const Vector& y, Vector& fastZDot);
+    void interpolateSlow(Real s, const Vector& y0, const Vector& yPred,
+                         const Vector& zf, Vector& y) const;
+
+    // A user request for fast variables; numZ == -1 means all the z's of
+    // the Subsystem. These are resolved into fastY at initialization.
+    struct FastZSpec {
+        FastZSpec(SubsystemIndex subsys, ZIndex firstZ, int numZ)
+        :   subsys(subsys), firstZ(firstZ), numZ(numZ) {}
+        SubsystemIndex  subsys;
+        ZIndex          firstZ;
+        int             numZ;
+    };
+    Array_<FastZSpec>   fastZSpecs;
+    int                 numSubsteps;
+    Stage               fastRateStage;
+
+    // Indices into y=[q u z] of the fast variables, in increasing order,
+    // and a per-y flag that is true for fast variables.
+    Array_<int>         fastY;
+    Array_<bool>        isFastY;
+
+    int statsSubstepsTaken, statsFastRealizations;
+
+    static const int NTemps = 3;
+    Vector ytmp[NTemps];
+    static const int NZTemps = 4;
+    Vector ztmp[NZTemps];
+};
+
+} // namespace SimTK
+
+#endif // SimTK_SIMMATH_MULTIRATE_INTEGRATOR_REP_H_
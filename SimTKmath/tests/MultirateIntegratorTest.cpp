@@ -0,0 +1,225 @@
+/* -------------------------------------------------------------------------- *
+ *                        Simbody(tm): SimTKmath                              *
+ * -------------------------------------------------------------------------- *
+ * This is part of the SimTK biosimulation toolkit originating from           *
+ * Simbios, the NIH National Center for Physics-Based Simulation of           *
+ * Biological Structures at Stanford, funded under the NIH Roadmap for        *
+ * Medical Research, grant U54 GM072970. See https://simtk.org/home/simbody.  *
+ *                                                                            *
+ * Portions copyright (c) 2014 Stanford University and the Authors.           *
+ * Authors:                                                                   *
+ * Contributors:                                                              *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.   *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+#include "IntegratorTestFramework.h"
+#include "simmath/MultirateIntegrator.h"
+#include "simmath/RungeKutta2Integrator.h"
+
+// This Subsystem has a single z that follows the pendulum's x coordinate
+// through a stiff first-order filter, zdot = -k (z - x). Like 
+// Force::Thermostat, it computes its derivative at Dynamics stage. It counts
+// its Dynamics and Acceleration stage realizations so that we can tell which
+// evaluations the integrator performed.
+class FilterSubsystemGuts : public Subsystem::Guts {
+public:
+    explicit FilterSubsystemGuts(Real k) : k(k) {}
+
+    FilterSubsystemGuts* cloneImpl() const OVERRIDE_11
+    {   return new FilterSubsystemGuts(*this); }
+
+    int realizeSubsystemTopologyImpl(State& s) const OVERRIDE_11 {
+        zx = allocateZ(s, Vector(1, Real(1))); // start at x
+        return 0;
+    }
+
+    int realizeSubsystemDynamicsImpl(const State& s) const OVERRIDE_11 {
+        ++numDynamicsRealizations;
+        const Real x = s.getQ()[0]; // the pendulum's q's come first
+        updZDot(s)[zx] = -k*(getZ(s)[zx] - x);
+        return 0;
+    }
+
+    int realizeSubsystemAccelerationImpl(const State& s) const OVERRIDE_11 {
+        ++numAccelerationRealizations;
+        return 0;
+    }
+
+    Real getFilteredX(const State& s) const {return getZ(s)[zx];}
+
+    static int numDynamicsRealizations, numAccelerationRealizations;
+private:
+    Real            k;
+    mutable ZIndex  zx;
+};
+int FilterSubsystemGuts::numDynamicsRealizations = 0;
+int FilterSubsystemGuts::numAccelerationRealizations = 0;
+
+class FilterSubsystem : public Subsystem {
+public:
+    FilterSubsystem(System& sys, Real k) {
+        adoptSubsystemGuts(new FilterSubsystemGuts(k));
+        sys.adoptSubsystem(*this);
+    }
+    Real getFilteredX(const State& s) const {
+        return dynamic_cast<const FilterSubsystemGuts&>(getSubsystemGuts())
+                .getFilteredX(s);
+    }
+};
+
+// Substep the filter at the default Dynamics fast rate stage. Check that the
+// substeps never realize Acceleration stage, and that the result agrees with
+// a tightly-converged single-rate solution. The filter is strongly coupled to
+// the slow pendulum motion, which exercises the coupling part of the error
+// estimate.
+void testFastDynamicsZ() {
+    PendulumSystem sys;
+    FilterSubsystem filter(sys, 200);
+    sys.realizeTopology();
+
+    const Real qi[] = {1,0}; // (x,y)=(1,0)
+    const Real ui[] = {0,0}; // v=0
+    sys.setDefaultMass(10);
+    sys.setDefaultTimeAndState(0, Vector(2, qi), Vector(2, ui));
+    const Real tFinal = 1.5;
+
+    RungeKutta2Integrator ref(sys);
+    ref.setAccuracy(1e-9);
+    ref.setConstraintTolerance(1e-10);
+    TimeStepper refts(sys, ref);
+    refts.initialize(sys.getDefaultState());
+    refts.stepTo(tFinal);
+    const Real zRef = filter.getFilteredX(ref.getState());
+    const Real xRef = ref.getState().getQ()[0];
+
+    const int n = 8;
+    MultirateIntegrator integ(sys, n);
+    integ.addFastSubsystem(filter.getMySubsystemIndex());
+    integ.setAccuracy(1e-5);
+    integ.setConstraintTolerance(1e-6);
+    ASSERT(integ.getFastRateStage() == Stage::Dynamics);
+
+    TimeStepper ts(sys, integ);
+    ts.initialize(sys.getDefaultState());
+    ASSERT(integ.getNumFastZ() == 1);
+
+    const int nReal0 = integ.getNumRealizations();
+    const int nDyn0  = FilterSubsystemGuts::numDynamicsRealizations;
+    const int nAcc0  = FilterSubsystemGuts::numAccelerationRealizations;
+
+    ts.stepTo(tFinal);
+    const State& state = integ.getState();
+    ASSERT(state.getTime() == tFinal);
+
+    const int nAttempted = integ.getNumStepsAttempted();
+    const int nReal = integ.getNumRealizations() - nReal0;
+    const int nDyn  = FilterSubsystemGuts::numDynamicsRealizations - nDyn0;
+    const int nAcc  = FilterSubsystemGuts::numAccelerationRealizations - nAcc0;
+
+    // Acceleration stage is reached only by the integrator's full 
+    // realizations, at most two per step regardless of n, and every other
+    // Dynamics stage realization is a fast one, 2n per step.
+    ASSERT(nAcc == nReal);
+    ASSERT(nReal <= 2*nAttempted);
+    ASSERT(integ.getNumFastRealizations() == 2*n*nAttempted);
+    ASSERT(nDyn - nAcc == integ.getNumFastRealizations());
+    ASSERT(integ.getNumSubstepsTaken() == n*nAttempted);
+
+    SimTK_TEST_EQ_TOL(filter.getFilteredX(state), zRef, 1e-3);
+    SimTK_TEST_EQ_TOL(state.getQ()[0], xRef, 1e-3);
+}
+
+// Add an auxiliary z to the pendulum whose derivative is the current time,
+// assign it to the fast rate, and check that it integrates to t^2/2. The
+// integrand is produced at Acceleration stage by Measure::Integrate so we 
+// can't use the default Dynamics fast rate stage here.
+void testFastZ() {
+    PendulumSystem sys;
+    DefaultSystemSubsystem& defsub = sys.updDefaultSubsystem();
+    Measure::Time tMeasure(defsub);
+    Measure::Integrate tSqrOver2(defsub, tMeasure, Measure::Zero(defsub));
+    sys.realizeTopology();
+
+    const Real qi[] = {1,0}; // (x,y)=(1,0)
+    const Real ui[] = {0,0}; // v=0
+    sys.setDefaultMass(10);
+    sys.setDefaultTimeAndState(0, Vector(2, qi), Vector(2, ui));
+
+    MultirateIntegrator integ(sys, 5);
+    integ.addFastSubsystem(defsub.getMySubsystemIndex());
+    integ.setFastRateStage(Stage::Acceleration);
+    integ.setAccuracy(1e-4);
+    integ.setConstraintTolerance(1e-4);
+
+    TimeStepper ts(sys);
+    ts.setIntegrator(integ);
+    ts.initialize(sys.getDefaultState());
+    ASSERT(integ.getNumFastZ() == 1);
+    ASSERT(integ.getNumSubsteps() == 5);
+
+    ts.stepTo(2.0);
+    const State& state = integ.getState();
+    ASSERT(state.getTime() == 2.0);
+    SimTK_TEST_EQ_TOL(tSqrOver2.getValue(state), 2.0, 1e-10);
+
+    // Each step substeps the fast variable; every substep but the first 
+    // needs its own fast realization at the beginning, and there is one more
+    // at the end of the step for the coupling error estimate.
+    const int nSteps = integ.getNumStepsAttempted();
+    ASSERT(integ.getNumSubstepsTaken() == 5*nSteps);
+    ASSERT(integ.getNumFastRealizations() == 10*nSteps);
+
+    // The pendulum itself must be unaffected by the fast variables.
+    const Vector& q = state.getQ();
+    SimTK_TEST_EQ_TOL(q[0]*q[0] + q[1]*q[1], 1, 1e-4);
+}
+
+int main () {
+  try {
+    PendulumSystem sys;
+    sys.addEventHandler(new ZeroVelocityHandler(sys));
+    sys.addEventHandler(PeriodicHandler::handler = new PeriodicHandler());
+    sys.addEventHandler(new ZeroPositionHandler(sys));
+    sys.addEventReporter(PeriodicReporter::reporter = new PeriodicReporter(sys));
+    sys.addEventReporter(new OnceOnlyEventReporter());
+    sys.addEventReporter(new DiscontinuousReporter());
+    sys.realizeTopology();
+
+    // Test with various intervals for the event handler and event reporter, 
+    // ones that are either large or small compared to the expected internal 
+    // step size of the integrator. With no fast variables this integrator
+    // behaves like the explicit trapezoid rule.
+
+    for (int i = 0; i < 4; ++i) {
+        PeriodicHandler::handler->setEventInterval
+           (i == 0 || i == 1 ? 0.01 : 2.0);
+        PeriodicReporter::reporter->setEventInterval
+           (i == 0 || i == 2 ? 0.015 : 1.5);
+        
+        // Test the integrator in both normal and single step modes.
+        
+        MultirateIntegrator integ(sys);
+        testIntegrator(integ, sys);
+        integ.setReturnEveryInternalStep(true);
+        testIntegrator(integ, sys);
+    }
+
+    testFastZ();
+    testFastDynamicsZ();
+    cout << "Done" << endl;
+    return 0;
+  }
+  catch (std::exception& e) {
+    std::printf("FAILED: %s\n", e.what());
+    return 1;
+  }
+}